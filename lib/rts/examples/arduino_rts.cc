@@ -69,7 +69,9 @@ void setup() {
 }
 
 void loop() {
-  // Send an Up command every 10 seconds.
+  // Send an Up command every 10 seconds. The payload for the next command is
+  // serialized while idle.
   g_controller.SendControlCode(rts::ControlCode::kUp);
+  g_controller.Prerender();
   delay(10000);
 }
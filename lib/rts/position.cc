@@ -0,0 +1,367 @@
+#include "position.h"
+
+#include <stdint.h>
+
+#include "rts.h"
+
+namespace rts {
+
+namespace {
+
+// Returns the signed difference 'a - b' between two wrapping timestamps.
+int32_t TimeDiff(const uint32_t a, const uint32_t b) {
+  return static_cast<int32_t>(a - b);
+}
+
+// Returns the time reserved for a scheduled command: the transmission, plus
+// one poll interval for the next command to be picked up.
+uint32_t ReservedMicroseconds() {
+  return TransmitFrameMicroseconds() + PositionController::kMaxPollIntervalUs;
+}
+
+// Returns true if commands scheduled at 'a' and 'b' overlap.
+bool Overlaps(const uint32_t a, const uint32_t b) {
+  const int32_t duration = ReservedMicroseconds();
+  const int32_t diff = TimeDiff(a, b);
+  return diff > -duration && diff < duration;
+}
+
+}  // namespace
+
+PositionController::PositionController(ClockInterface* const clock)
+    : clock_(clock) {}
+
+int PositionController::AddShade(
+    Controller* const controller,
+    const TravelTime& travel_time,
+    const uint8_t position) {
+  if (num_shades_ >= kMaxShades || travel_time.up_ms == 0 ||
+      travel_time.down_ms == 0 || position > kOpen) {
+    return -1;
+  }
+
+  Shade& shade = shades_[num_shades_];
+  shade.controller = controller;
+  shade.travel_time = travel_time;
+  shade.moving = false;
+  shade.direction = ControlCode::kMy;
+  shade.motion_start_us = 0;
+  shade.position = position * (kFullTravel / kOpen);
+  shade.target = shade.position;
+  shade.start_pending = false;
+  shade.start_direction = ControlCode::kMy;
+  shade.start_at_us = 0;
+  shade.stop_pending = false;
+  shade.stop_at_us = 0;
+  return num_shades_++;
+}
+
+bool PositionController::MoveTo(const int index, const uint8_t position) {
+  if (index < 0 || index >= num_shades_ || position > kOpen) {
+    return false;
+  }
+
+  Shade& shade = shades_[index];
+  const uint32_t now_us = clock_->NowMicroseconds();
+  const uint16_t current = EstimatePosition(shade, now_us);
+  const uint16_t target = position * (kFullTravel / kOpen);
+  const ControlCode direction =
+      target > current ? ControlCode::kUp : ControlCode::kDown;
+
+  if (target == current || (shade.moving && shade.direction == direction)) {
+    // Already at or moving towards the target; only the stop command changes.
+    shade.target = target;
+    shade.start_pending = false;
+    shade.stop_pending = false;
+    if (shade.moving && !IsEndStop(target)) {
+      const uint32_t stop_us =
+          target == current
+              ? now_us
+              : shade.motion_start_us +
+                    TravelMicroseconds(shade, shade.position, target) -
+                    FirstFrameMicroseconds();
+      ScheduleStop(&shade, stop_us, now_us, now_us);
+    }
+    return true;
+  }
+
+  // The stop command cannot be sent before the start command's transmission is
+  // over. A reversing shade keeps moving away from the target until the start
+  // command takes effect, which only makes the move longer.
+  if (!IsEndStop(target) &&
+      TravelMicroseconds(
+          shade, EstimatePosition(shade, now_us + FirstFrameMicroseconds()),
+          target) < ReservedMicroseconds()) {
+    return false;
+  }
+
+  shade.target = target;
+  shade.start_direction = direction;
+  shade.start_pending = false;
+  shade.stop_pending = false;
+  ScheduleStart(&shade, now_us);
+  return true;
+}
+
+uint8_t PositionController::position(const int index) const {
+  if (index < 0 || index >= num_shades_) {
+    return 0;
+  }
+
+  const uint16_t position =
+      EstimatePosition(shades_[index], clock_->NowMicroseconds());
+  static constexpr uint16_t kUnitsPerPercent = kFullTravel / kOpen;
+  return (position + kUnitsPerPercent / 2) / kUnitsPerPercent;
+}
+
+bool PositionController::busy(const int index) const {
+  if (index < 0 || index >= num_shades_) {
+    return false;
+  }
+
+  const Shade& shade = shades_[index];
+  return shade.moving || shade.start_pending || shade.stop_pending;
+}
+
+void PositionController::Poll() {
+  // Prerendering is a no-op for controllers that are already prerendered, so
+  // after a command is sent, only that controller's payloads are serialized.
+  for (int i = 0; i < num_shades_; ++i) {
+    shades_[i].controller->Prerender();
+  }
+
+  const uint32_t now_us = clock_->NowMicroseconds();
+  Shade* next = nullptr;
+  int32_t next_wait_us = 0;
+  for (int i = 0; i < num_shades_; ++i) {
+    Shade& shade = shades_[i];
+
+    if (shade.moving && !shade.start_pending && !shade.stop_pending) {
+      // Moving to an end stop. The shade stops by itself.
+      const uint16_t current = EstimatePosition(shade, now_us);
+      if (IsEndStop(current)) {
+        shade.position = current;
+        shade.moving = false;
+      }
+      continue;
+    }
+
+    // A stop command is never due before the start command of the same move.
+    int32_t wait_us;
+    if (shade.start_pending) {
+      wait_us = TimeDiff(shade.start_at_us, now_us);
+    } else if (shade.stop_pending) {
+      wait_us = TimeDiff(shade.stop_at_us, now_us);
+    } else {
+      continue;
+    }
+
+    if (next == nullptr || wait_us < next_wait_us) {
+      next = &shade;
+      next_wait_us = wait_us;
+    }
+  }
+
+  if (next == nullptr ||
+      next_wait_us > static_cast<int32_t>(kMaxPollIntervalUs)) {
+    return;
+  }
+
+  if (next_wait_us > 0) {
+    clock_->DelayMicroseconds(next_wait_us);
+  }
+
+  if (next->start_pending) {
+    Start(next);
+  } else {
+    Stop(next);
+  }
+}
+
+uint16_t PositionController::EstimatePosition(
+    const Shade& shade, const uint32_t time_us) const {
+  const int32_t elapsed_us = TimeDiff(time_us, shade.motion_start_us);
+  if (!shade.moving || elapsed_us <= 0) {
+    return shade.position;
+  }
+
+  const uint32_t travel_ms = shade.direction == ControlCode::kUp
+                                 ? shade.travel_time.up_ms
+                                 : shade.travel_time.down_ms;
+  const uint64_t distance =
+      static_cast<uint64_t>(elapsed_us) * kFullTravel / (travel_ms * 1000ULL);
+  if (shade.direction == ControlCode::kUp) {
+    return distance >= static_cast<uint16_t>(kFullTravel - shade.position)
+               ? kFullTravel
+               : shade.position + distance;
+  }
+  return distance >= shade.position ? 0 : shade.position - distance;
+}
+
+uint32_t PositionController::TravelMicroseconds(
+    const Shade& shade, const uint16_t from, const uint16_t to) const {
+  const uint32_t travel_ms =
+      to > from ? shade.travel_time.up_ms : shade.travel_time.down_ms;
+  const uint16_t distance = to > from ? to - from : from - to;
+  return static_cast<uint64_t>(travel_ms) * 1000 * distance / kFullTravel;
+}
+
+uint32_t PositionController::FindStartTime(
+    const Shade& shade, const uint32_t now_us) const {
+  uint32_t start_us = now_us;
+
+  // Both the start and the stop only move forward: the stop is the start plus
+  // the travel time, which does not shrink as the start is delayed, since a
+  // shade that is not resting moves away from its target until the start takes
+  // effect. Each conflict moves the start or the stop past one of the other
+  // shades' scheduled commands, so each of those commands is passed at most
+  // once by the start and once by the stop, and the loop ends.
+  for (;;) {
+    uint32_t conflict_us;
+    if (FindConflict(shade, start_us, /*stops_only=*/false, &conflict_us)) {
+      start_us = conflict_us + ReservedMicroseconds();
+      continue;
+    }
+    if (IsEndStop(shade.target)) {
+      break;
+    }
+
+    const uint16_t from =
+        EstimatePosition(shade, start_us + FirstFrameMicroseconds());
+    const uint32_t stop_us =
+        start_us + TravelMicroseconds(shade, from, shade.target);
+    if (FindConflict(shade, stop_us, /*stops_only=*/false, &conflict_us)) {
+      start_us += conflict_us + ReservedMicroseconds() - stop_us;
+      continue;
+    }
+    break;
+  }
+  return start_us;
+}
+
+bool PositionController::FindConflict(
+    const Shade& shade, const uint32_t time_us, const bool stops_only,
+    uint32_t* const conflict_us) const {
+  for (int i = 0; i < num_shades_; ++i) {
+    const Shade& other = shades_[i];
+    if (&other == &shade || (stops_only && other.start_pending)) {
+      continue;
+    }
+    if (other.start_pending && Overlaps(time_us, other.start_at_us)) {
+      *conflict_us = other.start_at_us;
+      return true;
+    }
+    if (other.stop_pending && Overlaps(time_us, other.stop_at_us)) {
+      *conflict_us = other.stop_at_us;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PositionController::ScheduleStart(
+    Shade* const shade, const uint32_t now_us) {
+  shade->start_pending = true;
+  shade->start_at_us = FindStartTime(*shade, now_us);
+  shade->stop_pending = false;
+  if (!IsEndStop(shade->target)) {
+    const uint16_t from = EstimatePosition(
+        *shade, shade->start_at_us + FirstFrameMicroseconds());
+    shade->stop_pending = true;
+    shade->stop_at_us =
+        shade->start_at_us + TravelMicroseconds(*shade, from, shade->target);
+  }
+}
+
+void PositionController::ScheduleStop(
+    Shade* const shade, uint32_t stop_us, const uint32_t earliest_us,
+    const uint32_t reschedule_after_us) {
+  if (TimeDiff(stop_us, earliest_us) < 0) {
+    stop_us = earliest_us;
+  }
+
+  // Find the nearest times after and before 'stop_us' that do not overlap the
+  // stop of another moving shade. Each conflict moves past another stop, so
+  // both searches end after at most kMaxShades - 1 conflicts.
+  uint32_t conflict_us;
+  uint32_t later_us = stop_us;
+  while (FindConflict(*shade, later_us, /*stops_only=*/true, &conflict_us)) {
+    later_us = conflict_us + ReservedMicroseconds();
+  }
+  uint32_t best_us = later_us;
+  if (later_us != stop_us) {
+    uint32_t earlier_us = stop_us;
+    bool found = true;
+    while (
+        FindConflict(*shade, earlier_us, /*stops_only=*/true, &conflict_us)) {
+      earlier_us = conflict_us - ReservedMicroseconds();
+      if (TimeDiff(earlier_us, earliest_us) < 0) {
+        found = false;
+        break;
+      }
+    }
+    if (found &&
+        TimeDiff(stop_us, earlier_us) < TimeDiff(later_us, stop_us)) {
+      best_us = earlier_us;
+    }
+  }
+
+  shade->stop_pending = true;
+  shade->stop_at_us = best_us;
+
+  // Moves that have not started yet make way for the stop.
+  for (int i = 0; i < num_shades_; ++i) {
+    Shade& other = shades_[i];
+    if (&other == shade || !other.start_pending) {
+      continue;
+    }
+    if (Overlaps(best_us, other.start_at_us) ||
+        (other.stop_pending && Overlaps(best_us, other.stop_at_us))) {
+      ScheduleStart(&other, reschedule_after_us);
+    }
+  }
+}
+
+void PositionController::Start(Shade* const shade) {
+  // The shade reacts once the initial frame is decoded.
+  const uint32_t kickoff_us = clock_->NowMicroseconds();
+  const uint32_t motion_start_us = kickoff_us + FirstFrameMicroseconds();
+
+  // If the shade is reversing, it keeps moving until the command takes effect.
+  shade->position = EstimatePosition(*shade, motion_start_us);
+  shade->moving = true;
+  shade->direction = shade->start_direction;
+  shade->motion_start_us = motion_start_us;
+  shade->start_pending = false;
+
+  // The start may have been delayed; keep the stop relative to it. The
+  // transmission about to be sent occupies the transmitter until
+  // 'busy_until_us', so nothing may be rescheduled into it.
+  if (shade->stop_pending) {
+    const uint32_t busy_until_us = kickoff_us + ReservedMicroseconds();
+    ScheduleStop(
+        shade,
+        kickoff_us + TravelMicroseconds(*shade, shade->position, shade->target),
+        busy_until_us, busy_until_us);
+  }
+
+  shade->controller->SendControlCode(shade->start_direction);
+}
+
+void PositionController::Stop(Shade* const shade) {
+  const uint32_t kickoff_us = clock_->NowMicroseconds();
+  shade->position =
+      EstimatePosition(*shade, kickoff_us + FirstFrameMicroseconds());
+  shade->moving = false;
+  shade->stop_pending = false;
+
+  // A shade at its end stop has already stopped by itself. kMy would move it to
+  // its favorite position instead.
+  if (IsEndStop(shade->position)) {
+    return;
+  }
+
+  shade->controller->SendControlCode(ControlCode::kMy);
+}
+
+}  // namespace rts
@@ -0,0 +1,185 @@
+#ifndef RTS_POSITION_H_
+#define RTS_POSITION_H_
+
+#include <stdint.h>
+
+#include "rts.h"
+
+namespace rts {
+
+// Interface for a monotonic microsecond clock. The position engine uses it to
+// schedule commands and to wait precisely for their deadlines.
+class ClockInterface {
+ public:
+  // Returns the current time in microseconds. The value may wrap around; only
+  // differences between timestamps less than ~35 minutes apart are used.
+  virtual uint32_t NowMicroseconds() const = 0;
+  // Wait for 'us' microseconds. Implementations must be accurate to well
+  // within a millisecond, since this determines when stop commands go out.
+  virtual void DelayMicroseconds(uint32_t us) = 0;
+};
+
+// Calibrated time for a shade to travel its full range in each direction.
+struct TravelTime {
+  // Time to travel from fully closed to fully open, in milliseconds.
+  uint32_t up_ms;
+  // Time to travel from fully open to fully closed, in milliseconds.
+  uint32_t down_ms;
+};
+
+// PositionController moves shades to intermediate positions. RTS is one-way,
+// so the position of a shade is estimated from calibrated travel times: a move
+// is a kUp or kDown command followed by a kMy (stop) command at the moment the
+// shade is expected to reach the target.
+//
+// Commands are not sent when requested. Instead, each command gets a deadline
+// and Poll() sends it, waiting for the deadline with the clock to get
+// sub-millisecond accuracy. Deadlines account for the transmission latency,
+// FirstFrameMicroseconds(), since receivers act on a command only once its
+// initial frame is decoded.
+//
+// All shades share one transmitter, which is busy for
+// TransmitFrameMicroseconds() per command. To keep stop commands for different
+// shades from delaying each other, MoveTo() delays the start of a move, which
+// is not time-critical, until neither its start nor its stop command overlaps
+// a command already scheduled for another shade. The stop of a shade that is
+// already moving cannot be delayed this way. It takes precedence over moves
+// that have not started yet, which are rescheduled. If it would overlap the
+// stop of another moving shade, it is sent at the nearest free time instead.
+// The shade then ends up slightly off target, and its estimated position
+// reflects that.
+class PositionController {
+ public:
+  // The maximum number of shades.
+  static constexpr int kMaxShades = 8;
+
+  // Position of a fully open shade, in percent. A fully closed shade is at 0.
+  static constexpr uint8_t kOpen = 100;
+
+  // Poll() waits for deadlines at most this far in the future. It must be
+  // called at least this often for commands to be sent on time.
+  static constexpr uint32_t kMaxPollIntervalUs = 2000;
+
+  // Initializes a controller without shades.
+  //
+  // 'clock' must remain valid for the lifetime of this object.
+  explicit PositionController(ClockInterface* clock);
+
+  // Adds a shade controlled by 'controller', with calibrated 'travel_time' and
+  // currently at 'position' percent. Returns the index of the shade, or -1 if
+  // there are already kMaxShades shades or the arguments are out of range.
+  //
+  // 'controller' must remain valid for the lifetime of this object, and must
+  // not be used to send commands by anything else.
+  int AddShade(
+      Controller* controller, const TravelTime& travel_time, uint8_t position);
+
+  // Schedules commands to move 'shade' to 'position' percent. Replaces any
+  // move in progress. Moves to kOpen or 0 are not stopped; the shade runs to
+  // its end stop.
+  //
+  // A stop command cannot be sent until the transmission of the start command
+  // is over, so a move that needs a start command must take at least
+  // TransmitFrameMicroseconds() + kMaxPollIntervalUs. Shorter moves are
+  // rejected. A shade already moving towards 'position' needs no start
+  // command. If it reaches 'position' sooner than the stop command can take
+  // effect, it is stopped right away.
+  //
+  // Returns false, leaving any move in progress unchanged, if 'shade' or
+  // 'position' is out of range or the move is too short.
+  bool MoveTo(int shade, uint8_t position);
+
+  // Returns the estimated position of 'shade' in percent, or 0 if 'shade' is
+  // out of range.
+  uint8_t position(int shade) const;
+
+  // Returns true if 'shade' is estimated to be moving or has commands
+  // scheduled.
+  bool busy(int shade) const;
+
+  // Prerenders the payloads of all controllers, then sends at most one command
+  // whose deadline is due within kMaxPollIntervalUs, earliest deadline first.
+  // Blocks while waiting for the deadline and for the transmission.
+  void Poll();
+
+ private:
+  // Positions are tracked in units of 1/kFullTravel of the full range.
+  static constexpr uint16_t kFullTravel = 10000;
+
+  struct Shade {
+    Controller* controller;
+    TravelTime travel_time;
+
+    // Whether the shade is moving in 'direction' (kUp or kDown). Once it
+    // started moving at 'motion_start_us', it was at 'position'. Otherwise,
+    // the shade rests at 'position'.
+    bool moving;
+    ControlCode direction;
+    uint32_t motion_start_us;
+    uint16_t position;
+
+    // Position the shade is moving to.
+    uint16_t target;
+
+    // Whether a start command in 'start_direction' is scheduled for
+    // 'start_at_us'.
+    bool start_pending;
+    ControlCode start_direction;
+    uint32_t start_at_us;
+
+    // Whether a stop command is scheduled for 'stop_at_us'.
+    bool stop_pending;
+    uint32_t stop_at_us;
+  };
+
+  // Returns true if 'position' is fully open or fully closed.
+  static bool IsEndStop(uint16_t position) {
+    return position == 0 || position == kFullTravel;
+  }
+
+  // Returns the estimated position of 'shade' at 'time_us'.
+  uint16_t EstimatePosition(const Shade& shade, uint32_t time_us) const;
+
+  // Returns the time, in microseconds, for 'shade' to travel from 'from' to
+  // 'to'.
+  uint32_t TravelMicroseconds(
+      const Shade& shade, uint16_t from, uint16_t to) const;
+
+  // Returns the earliest time at or after 'now_us' at which a command for
+  // 'shade' to move to its target can be started, such that neither the start
+  // nor the stop command overlaps a command scheduled for another shade.
+  uint32_t FindStartTime(const Shade& shade, uint32_t now_us) const;
+
+  // Returns true if a command at 'time_us' overlaps a command scheduled for a
+  // shade other than 'shade'. If so, '*conflict_us' is set to the time of the
+  // overlapped command. If 'stops_only' is true, only the stop commands of
+  // shades that are already moving are considered.
+  bool FindConflict(const Shade& shade, uint32_t time_us, bool stops_only,
+                    uint32_t* conflict_us) const;
+
+  // Schedules the start command of 'shade' to move to its target, and the stop
+  // command if the target is not an end stop.
+  void ScheduleStart(Shade* shade, uint32_t now_us);
+
+  // Schedules the stop command of 'shade', which is moving or about to start
+  // moving, as close to 'stop_us' as possible but not before 'earliest_us',
+  // and without overlapping the stop command of another moving shade. Moves of
+  // other shades that have not started and overlap the stop are rescheduled to
+  // start at or after 'reschedule_after_us'.
+  void ScheduleStop(Shade* shade, uint32_t stop_us, uint32_t earliest_us,
+                    uint32_t reschedule_after_us);
+
+  // Sends the start command for 'shade'.
+  void Start(Shade* shade);
+
+  // Sends the stop command for 'shade'.
+  void Stop(Shade* shade);
+
+  ClockInterface* const clock_;  // Not owned.
+  Shade shades_[kMaxShades];
+  int num_shades_ = 0;
+};
+
+}  // namespace rts
+
+#endif  // RTS_POSITION_H_
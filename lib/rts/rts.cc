@@ -13,7 +13,31 @@ namespace {
 // symbol width of 1208us (not 1280us). The width of 1280us is from a Telis 4
 // RTS remote (FCC ID DWNTELIS4), observed with a HackRF. 1280us is the value
 // cited in patent US8189620.
-constexpr int kSymbolUs = 1280;
+constexpr uint32_t kSymbolUs = 1280;
+
+// Timing of the wakeup pulse, synchronization pulses, and the silence between
+// repeated frames. These are 32 bits wide since some exceed a 16-bit int.
+constexpr uint32_t kWakeupPulseUs = 10000;
+constexpr uint32_t kWakeupSilenceUs = 38000;
+constexpr uint32_t kHardwareSyncUs = 2500;
+constexpr uint32_t kSoftwareSyncUs = 4800;
+// ~34ms of silence before the next hardware sync according to US8189620B2.
+constexpr uint32_t kInterFrameSilenceUs = 34000;
+
+// Number of hardware sync pulses before the initial frame and before each
+// repeated frame.
+constexpr int kInitialHardwareSyncs = 2;
+constexpr int kRepeatedHardwareSyncs = 6;
+
+// Number of times a frame is repeated after the initial frame.
+constexpr int kRepeatedFrames = 5;
+
+// Duration of 'iterations' hardware sync pulses, a software sync pulse, and
+// the Manchester-encoded payload.
+constexpr uint32_t FrameUs(const int iterations) {
+  return iterations * 2 * kHardwareSyncUs + kSoftwareSyncUs + kSymbolUs / 2 +
+         Frame::kPayloadLength * 8 * kSymbolUs;
+}
 
 // Returns the checksum of the Frame serialized in '*payload'. The checksum
 // field must be set to 0 before calling this function.
@@ -44,26 +68,26 @@ void Deobfuscate(uint8_t* const payload) {
   }
 }
 
-void Pulse(const int us, TransmitInterface* const tx) {
+void Pulse(const uint32_t us, TransmitInterface* const tx) {
   tx->SetHigh();
   tx->DelayMicroseconds(us);
   tx->SetLow();
 }
 
 void WakeupPulse(TransmitInterface* const tx) {
-  Pulse(/*us=*/10000, tx);
-  tx->DelayMicroseconds(38000);
+  Pulse(kWakeupPulseUs, tx);
+  tx->DelayMicroseconds(kWakeupSilenceUs);
 }
 
 void HardwareSync(int iterations, TransmitInterface* const tx) {
   for (; iterations > 0; --iterations) {
-    Pulse(2500, tx);
-    tx->DelayMicroseconds(2500);
+    Pulse(kHardwareSyncUs, tx);
+    tx->DelayMicroseconds(kHardwareSyncUs);
   }
 }
 
 void SoftwareSync(TransmitInterface* const tx) {
-  Pulse(4800, tx);
+  Pulse(kSoftwareSyncUs, tx);
   tx->DelayMicroseconds(kSymbolUs / 2);
 }
 
@@ -87,15 +111,13 @@ void ShiftOutByte(const uint8_t byte, TransmitInterface* const tx) {
   tx->SetLow();
 }
 
-void ShiftOutFrame(const Frame& frame, TransmitInterface* const tx) {
-  uint8_t payload[Frame::kPayloadLength];
-  SerializeFrame(frame, payload);
-
+void ShiftOutPayload(const uint8_t* const payload,
+                     TransmitInterface* const tx) {
   // Payload, Manchester encoded, with one bit per kSymbolUs.
   //
   //   Zero: half-symbol high, half-symbol low.
   //    One: half-symbol low, half-symbol high.
-  for (unsigned int i = 0; i < sizeof(payload); ++i) {
+  for (int i = 0; i < Frame::kPayloadLength; ++i) {
     ShiftOutByte(payload[i], tx);
   }
 }
@@ -122,22 +144,70 @@ Controller::Controller(
     TransmitInterface* const tx)
     : frame_(address), rc_(rc), tx_(tx) {
   frame_.set_rolling_code(rc->Read());
+  for (int i = 0; i < kNumPrerendered; ++i) {
+    prerendered_[i].control_code = kPrerenderedCodes[i];
+  }
+  InvalidatePrerendered();
 }
 
 void Controller::SendControlCode(const ControlCode code) {
   frame_.set_control_code(code);
 
-  // Transmit the frame.
-  TransmitFrame(frame_, tx_);
+  // Transmit the frame, skipping serialization if it was done ahead of time.
+  const PrerenderedPayload* const prerendered = FindPrerendered(code);
+  if (prerendered != nullptr && prerendered->valid) {
+    TransmitPayload(prerendered->payload, tx_);
+  } else {
+    TransmitFrame(frame_, tx_);
+  }
 
-  // Increment counter and rolling code for the *next* frame to be sent.
+  // Increment counter and rolling code for the *next* frame to be sent. This
+  // makes all prerendered payloads stale.
   frame_.set_counter(frame_.counter() + 1);
   frame_.set_rolling_code(frame_.rolling_code() + 1);
+  InvalidatePrerendered();
 
   // Call the callback to update the rolling code in persistent storage.
   rc_->Write(frame_.rolling_code());
 }
 
+void Controller::Prerender() {
+  for (PrerenderedPayload& prerendered : prerendered_) {
+    if (prerendered.valid) {
+      continue;
+    }
+    Frame frame = frame_;
+    frame.set_control_code(prerendered.control_code);
+    SerializeFrame(frame, prerendered.payload);
+    prerendered.valid = true;
+  }
+}
+
+const uint8_t* Controller::prerendered_payload(const ControlCode code) const {
+  for (const PrerenderedPayload& prerendered : prerendered_) {
+    if (prerendered.control_code == code && prerendered.valid) {
+      return prerendered.payload;
+    }
+  }
+  return nullptr;
+}
+
+Controller::PrerenderedPayload* Controller::FindPrerendered(
+    const ControlCode code) {
+  for (PrerenderedPayload& prerendered : prerendered_) {
+    if (prerendered.control_code == code) {
+      return &prerendered;
+    }
+  }
+  return nullptr;
+}
+
+void Controller::InvalidatePrerendered() {
+  for (PrerenderedPayload& prerendered : prerendered_) {
+    prerendered.valid = false;
+  }
+}
+
 //   byte
 //    0       1        2       3       4       5       6
 // |-------|--------|-------|-------|-------|-------|-------|
@@ -195,23 +265,40 @@ bool DeserializeFrame(const uint8_t* const payload, Frame* const frame) {
 }
 
 void TransmitFrame(const Frame& frame, TransmitInterface* const tx) {
+  uint8_t payload[Frame::kPayloadLength];
+  SerializeFrame(frame, payload);
+  TransmitPayload(payload, tx);
+}
+
+void TransmitPayload(
+    const uint8_t* const payload, TransmitInterface* const tx) {
   WakeupPulse(tx);
 
   // Initial frame.
-  HardwareSync(/*iterations=*/2, tx);
+  HardwareSync(kInitialHardwareSyncs, tx);
   SoftwareSync(tx);
-  ShiftOutFrame(frame, tx);
+  ShiftOutPayload(payload, tx);
 
   // Repeated frames.
-  for (int i = 0; i < 5; ++i) {
-    // ~34ms of silence before the next hardware sync according to US8189620B2.
-    tx->DelayMicroseconds(34000);
-    HardwareSync(/*iterations=*/6, tx);
+  for (int i = 0; i < kRepeatedFrames; ++i) {
+    tx->DelayMicroseconds(kInterFrameSilenceUs);
+    HardwareSync(kRepeatedHardwareSyncs, tx);
     SoftwareSync(tx);
-    ShiftOutFrame(frame, tx);
+    ShiftOutPayload(payload, tx);
   }
 
-  tx->DelayMicroseconds(34000);
+  tx->DelayMicroseconds(kInterFrameSilenceUs);
+}
+
+uint32_t FirstFrameMicroseconds() {
+  return kWakeupPulseUs + kWakeupSilenceUs + FrameUs(kInitialHardwareSyncs);
+}
+
+uint32_t TransmitFrameMicroseconds() {
+  return FirstFrameMicroseconds() +
+         kRepeatedFrames *
+             (kInterFrameSilenceUs + FrameUs(kRepeatedHardwareSyncs)) +
+         kInterFrameSilenceUs;
 }
 
 }  // namespace rts
@@ -131,11 +131,52 @@ class Controller {
   // 'rc' and 'tx' must remain valid for the lifetime of this object.
   Controller(uint32_t address, RollingCodeInterface* rc, TransmitInterface* tx);
 
-  // Sends a single command using the RTS protocol to the RF transmitter.
+  // Sends a single command using the RTS protocol to the RF transmitter. If the
+  // payload for 'code' was prerendered with Prerender(), it is transmitted
+  // without serializing the frame again.
   void SendControlCode(ControlCode code);
 
+  // Serializes the payloads for the next rolling code and the common control
+  // codes (kUp, kDown, kMy) ahead of time, so that SendControlCode() can start
+  // transmitting immediately. Payloads that are already prerendered are left
+  // alone, so this is cheap to call repeatedly, e.g., from an idle loop.
+  //
+  // With a TransmitInterface that bit-bangs the data pin, this does not reduce
+  // the latency until the first RF edge: the wakeup pulse is sent before the
+  // payload is needed. It only helps implementations that need the payload
+  // before their first edge.
+  //
+  // Prerendered payloads are discarded whenever the rolling code advances.
+  void Prerender();
+
+  // Returns the payload prerendered for 'code' with the current rolling code,
+  // or nullptr if there is none.
+  const uint8_t* prerendered_payload(ControlCode code) const;
+
  private:
+  // A payload serialized ahead of time for the current rolling code.
+  struct PrerenderedPayload {
+    ControlCode control_code;
+    // Whether 'payload' matches the current frame and 'control_code'.
+    bool valid;
+    uint8_t payload[Frame::kPayloadLength];
+  };
+
+  // Control codes prerendered by Prerender(), most common first.
+  static constexpr ControlCode kPrerenderedCodes[] = {
+      ControlCode::kMy, ControlCode::kUp, ControlCode::kDown};
+  static constexpr int kNumPrerendered =
+      sizeof(kPrerenderedCodes) / sizeof(kPrerenderedCodes[0]);
+
+  // Returns the prerendered payload for 'code', or nullptr if 'code' is not one
+  // of kPrerenderedCodes.
+  PrerenderedPayload* FindPrerendered(ControlCode code);
+
+  // Discards all prerendered payloads.
+  void InvalidatePrerendered();
+
   Frame frame_;
+  PrerenderedPayload prerendered_[kNumPrerendered];
   RollingCodeInterface* const rc_;  // Not owned.
   TransmitInterface* const tx_;  // Not owned.
 };
@@ -153,6 +194,20 @@ bool DeserializeFrame(const uint8_t* payload, Frame* frame);
 // as required by the RTS protocol.
 void TransmitFrame(const Frame& frame, TransmitInterface* tx);
 
+// Same as TransmitFrame(), but sends a frame that was already serialized with
+// SerializeFrame(). '*payload' must be at least Frame::kPayloadLength bytes.
+void TransmitPayload(const uint8_t* payload, TransmitInterface* tx);
+
+// Returns the time, in microseconds, from the start of TransmitFrame() until
+// the end of the initial frame. RTS receivers act on a command as soon as the
+// initial frame is decoded; the repeated frames only guard against
+// interference.
+uint32_t FirstFrameMicroseconds();
+
+// Returns the total duration of TransmitFrame(), in microseconds, including
+// the repeated frames. The transmitter is busy for this long per command.
+uint32_t TransmitFrameMicroseconds();
+
 }  // namespace rts
 
 #endif  // RTS_H_
@@ -0,0 +1,382 @@
+#include <stdint.h>
+#include <unity.h>
+
+#include "position.h"
+#include "rts.h"
+
+// VirtualClock is an implementation of rts::ClockInterface that operates in
+// virtual time. Time only advances when DelayMicroseconds() or Advance() is
+// called.
+class VirtualClock : public rts::ClockInterface {
+ public:
+  // Initializes a clock whose DelayMicroseconds() waits 'overshoot_us' longer
+  // than requested, like a real clock would.
+  explicit VirtualClock(uint32_t overshoot_us = 0)
+      : overshoot_us_(overshoot_us) {}
+
+  uint32_t NowMicroseconds() const override { return time_; }
+  void DelayMicroseconds(uint32_t us) override { Advance(us + overshoot_us_); }
+
+  // Advances virtual time by exactly 'us' microseconds.
+  void Advance(uint32_t us) { time_ += us; }
+
+ private:
+  const uint32_t overshoot_us_;
+  // Starts close to wrapping around to exercise the timestamp arithmetic.
+  uint32_t time_ = 0xFFFFFFFF - 5000000;
+};
+
+// Implementation of rts::TransmitInterface that discards all data and advances
+// a VirtualClock for every delay.
+class VirtualTransmitter : public rts::TransmitInterface {
+ public:
+  explicit VirtualTransmitter(VirtualClock* clock) : clock_(clock) {}
+
+  void SetHigh() override {}
+  void SetLow() override {}
+  void DelayMicroseconds(uint32_t us) override { clock_->Advance(us); }
+
+ private:
+  VirtualClock* const clock_;
+};
+
+// Implementation of rts::RollingCodeInterface that records when each command
+// was sent. The rolling code is written at the end of a transmission, so the
+// transmission started TransmitFrameMicroseconds() earlier.
+class RecordingRollingCode : public rts::RollingCodeInterface {
+ public:
+  static constexpr int kMaxCommands = 8;
+
+  explicit RecordingRollingCode(const VirtualClock* clock) : clock_(clock) {}
+
+  uint16_t Read() const override { return rolling_code_; }
+  void Write(uint16_t rolling_code) override {
+    rolling_code_ = rolling_code;
+    if (num_commands_ < kMaxCommands) {
+      kickoff_us_[num_commands_] =
+          clock_->NowMicroseconds() - rts::TransmitFrameMicroseconds();
+    }
+    ++num_commands_;
+  }
+
+  // Number of commands sent.
+  int num_commands() const { return num_commands_; }
+
+  // Returns the time at which the transmission of command 'i' started.
+  uint32_t kickoff_us(int i) const { return kickoff_us_[i]; }
+
+ private:
+  const VirtualClock* const clock_;
+  uint16_t rolling_code_ = 0;
+  int num_commands_ = 0;
+  uint32_t kickoff_us_[kMaxCommands];
+};
+
+static constexpr rts::TravelTime kTravelTime = {/*up_ms=*/22000,
+                                                /*down_ms=*/20000};
+
+// Polls 'controller' until 'shade' is idle.
+void PollUntilIdle(
+    rts::PositionController* controller, int shade, VirtualClock* clock) {
+  for (int i = 0; i < 1000000 && controller->busy(shade); ++i) {
+    controller->Poll();
+    clock->DelayMicroseconds(500);
+  }
+  TEST_ASSERT_FALSE(controller->busy(shade));
+}
+
+// Returns true if transmissions started at 'a' and 'b' do not overlap.
+bool Disjoint(uint32_t a, uint32_t b) {
+  const int32_t diff = a - b;
+  const int32_t duration = rts::TransmitFrameMicroseconds();
+  return diff >= duration || -diff >= duration;
+}
+
+// Polls 'controller' until 'time_us'.
+void PollUntil(
+    rts::PositionController* controller, uint32_t time_us,
+    VirtualClock* clock) {
+  while (static_cast<int32_t>(clock->NowMicroseconds() - time_us) < 0) {
+    controller->Poll();
+    clock->DelayMicroseconds(500);
+  }
+}
+
+void TestMoveTo_StopsOnTime() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc(&clock);
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+  rts::PositionController positioner(&clock);
+  const int shade = positioner.AddShade(&controller, kTravelTime, 100);
+  TEST_ASSERT_EQUAL(0, shade);
+
+  const uint32_t start_us = clock.NowMicroseconds();
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 40));
+  TEST_ASSERT_TRUE(positioner.busy(shade));
+
+  // Poll until halfway through the move.
+  const uint32_t halfway_us =
+      start_us + rts::FirstFrameMicroseconds() + 6000000;
+  while (static_cast<int32_t>(clock.NowMicroseconds() - halfway_us) < 0) {
+    positioner.Poll();
+    clock.DelayMicroseconds(500);
+  }
+  TEST_ASSERT_EQUAL(1, rc.num_commands());
+  TEST_ASSERT_EQUAL(70, positioner.position(shade));
+
+  PollUntilIdle(&positioner, shade, &clock);
+
+  // The start command is sent immediately. The stop command is sent exactly
+  // 60% of the down travel time later, so that both commands take effect after
+  // the same latency.
+  TEST_ASSERT_EQUAL(2, rc.num_commands());
+  TEST_ASSERT_EQUAL_UINT32(start_us, rc.kickoff_us(0));
+  TEST_ASSERT_EQUAL_UINT32(12000000, rc.kickoff_us(1) - rc.kickoff_us(0));
+  TEST_ASSERT_EQUAL(40, positioner.position(shade));
+}
+
+void TestMoveTo_EndStop() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc(&clock);
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+  rts::PositionController positioner(&clock);
+  const int shade = positioner.AddShade(&controller, kTravelTime, 40);
+
+  // Moves to an end stop are not stopped.
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 100));
+  PollUntilIdle(&positioner, shade, &clock);
+  TEST_ASSERT_EQUAL(1, rc.num_commands());
+  TEST_ASSERT_EQUAL(100, positioner.position(shade));
+
+  // Moving to the current position does nothing.
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 100));
+  TEST_ASSERT_FALSE(positioner.busy(shade));
+  TEST_ASSERT_EQUAL(1, rc.num_commands());
+}
+
+void TestMoveTo_InvalidArguments() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc(&clock);
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+  rts::PositionController positioner(&clock);
+
+  TEST_ASSERT_EQUAL(-1, positioner.AddShade(&controller, kTravelTime, 101));
+  TEST_ASSERT_EQUAL(
+      -1, positioner.AddShade(&controller, {/*up_ms=*/0, /*down_ms=*/0}, 0));
+  TEST_ASSERT_FALSE(positioner.MoveTo(0, 50));
+
+  const int shade = positioner.AddShade(&controller, kTravelTime, 0);
+  TEST_ASSERT_FALSE(positioner.MoveTo(shade, 101));
+  TEST_ASSERT_FALSE(positioner.MoveTo(shade + 1, 50));
+}
+
+void TestMoveTo_ConcurrentShades() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc_a(&clock);
+  RecordingRollingCode rc_b(&clock);
+  rts::Controller controller_a(/*address=*/0xC0FFEE, &rc_a, &tx);
+  rts::Controller controller_b(/*address=*/0xC0FFEF, &rc_b, &tx);
+  rts::PositionController positioner(&clock);
+  const int a = positioner.AddShade(&controller_a, kTravelTime, 100);
+  const int b = positioner.AddShade(&controller_b, kTravelTime, 100);
+
+  // Without scheduling, both shades would start at once, and their stop
+  // commands would be less than one transmission apart.
+  const uint32_t start_us = clock.NowMicroseconds();
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 40));
+  TEST_ASSERT_TRUE(positioner.MoveTo(b, 45));
+  PollUntilIdle(&positioner, a, &clock);
+  PollUntilIdle(&positioner, b, &clock);
+
+  TEST_ASSERT_EQUAL(2, rc_a.num_commands());
+  TEST_ASSERT_EQUAL(2, rc_b.num_commands());
+
+  // Both stop commands are sent exactly on time.
+  TEST_ASSERT_EQUAL_UINT32(start_us, rc_a.kickoff_us(0));
+  TEST_ASSERT_EQUAL_UINT32(12000000, rc_a.kickoff_us(1) - rc_a.kickoff_us(0));
+  TEST_ASSERT_EQUAL_UINT32(11000000, rc_b.kickoff_us(1) - rc_b.kickoff_us(0));
+  TEST_ASSERT_EQUAL(40, positioner.position(a));
+  TEST_ASSERT_EQUAL(45, positioner.position(b));
+
+  // No two transmissions overlap.
+  TEST_ASSERT_TRUE(Disjoint(rc_a.kickoff_us(0), rc_b.kickoff_us(0)));
+  TEST_ASSERT_TRUE(Disjoint(rc_a.kickoff_us(1), rc_b.kickoff_us(1)));
+}
+
+void TestMoveTo_RetargetWithPendingStops() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc_a(&clock);
+  RecordingRollingCode rc_b(&clock);
+  rts::Controller controller_a(/*address=*/0xC0FFEE, &rc_a, &tx);
+  rts::Controller controller_b(/*address=*/0xC0FFEF, &rc_b, &tx);
+  rts::PositionController positioner(&clock);
+  const int a = positioner.AddShade(&controller_a, kTravelTime, 100);
+  const int b = positioner.AddShade(&controller_b, kTravelTime, 100);
+
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 10));
+  TEST_ASSERT_TRUE(positioner.MoveTo(b, 40));
+  PollUntil(&positioner, clock.NowMicroseconds() + 5000000, &clock);
+  TEST_ASSERT_EQUAL(1, rc_a.num_commands());
+  TEST_ASSERT_EQUAL(1, rc_b.num_commands());
+
+  // Retarget A so that its stop would be sent less than one transmission
+  // before B's stop. B's stop must not be delayed.
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 36));
+  PollUntilIdle(&positioner, a, &clock);
+  PollUntilIdle(&positioner, b, &clock);
+
+  TEST_ASSERT_EQUAL(2, rc_b.num_commands());
+  TEST_ASSERT_EQUAL_UINT32(12000000, rc_b.kickoff_us(1) - rc_b.kickoff_us(0));
+  TEST_ASSERT_EQUAL(40, positioner.position(b));
+
+  // A's stop is moved to the nearest free time instead, and its estimated
+  // position matches the time the stop was actually sent.
+  TEST_ASSERT_EQUAL(2, rc_a.num_commands());
+  TEST_ASSERT_TRUE(Disjoint(rc_a.kickoff_us(1), rc_b.kickoff_us(1)));
+  const uint32_t travel_us = rc_a.kickoff_us(1) - rc_a.kickoff_us(0);
+  TEST_ASSERT_EQUAL(100 - (travel_us + 100000) / 200000,
+                    positioner.position(a));
+  TEST_ASSERT_UINT32_WITHIN(5, 36, positioner.position(a));
+}
+
+void TestMoveTo_StopDisplacesPendingStart() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc_a(&clock);
+  RecordingRollingCode rc_b(&clock);
+  rts::Controller controller_a(/*address=*/0xC0FFEE, &rc_a, &tx);
+  rts::Controller controller_b(/*address=*/0xC0FFEF, &rc_b, &tx);
+  rts::PositionController positioner(&clock);
+  // B is added first, so that it would win a tie between deadlines.
+  const int b = positioner.AddShade(&controller_b, kTravelTime, 100);
+  const int a = positioner.AddShade(&controller_a, kTravelTime, 100);
+
+  // Move A down, and wait until it is at exactly 90%.
+  const uint32_t start_us = clock.NowMicroseconds();
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 0));
+  positioner.Poll();
+  TEST_ASSERT_EQUAL(1, rc_a.num_commands());
+  const uint32_t at_90_us = start_us + rts::FirstFrameMicroseconds() + 2000000;
+  clock.DelayMicroseconds(at_90_us - clock.NowMicroseconds());
+
+  // B's move is scheduled to start right away, but stopping A at 90% takes
+  // precedence.
+  TEST_ASSERT_TRUE(positioner.MoveTo(b, 40));
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 90));
+  PollUntilIdle(&positioner, a, &clock);
+  PollUntilIdle(&positioner, b, &clock);
+
+  TEST_ASSERT_EQUAL(2, rc_a.num_commands());
+  TEST_ASSERT_EQUAL_UINT32(at_90_us, rc_a.kickoff_us(1));
+  TEST_ASSERT_EQUAL(2, rc_b.num_commands());
+  TEST_ASSERT_TRUE(Disjoint(rc_a.kickoff_us(1), rc_b.kickoff_us(0)));
+  TEST_ASSERT_EQUAL_UINT32(12000000, rc_b.kickoff_us(1) - rc_b.kickoff_us(0));
+  TEST_ASSERT_EQUAL(40, positioner.position(b));
+}
+
+void TestMoveTo_ClockOvershoot() {
+  VirtualClock clock(/*overshoot_us=*/20);
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc_a(&clock);
+  RecordingRollingCode rc_b(&clock);
+  RecordingRollingCode rc_c(&clock);
+  rts::Controller controller_a(/*address=*/0xC0FFEE, &rc_a, &tx);
+  rts::Controller controller_b(/*address=*/0xC0FFEF, &rc_b, &tx);
+  rts::Controller controller_c(/*address=*/0xC0FFF0, &rc_c, &tx);
+  rts::PositionController positioner(&clock);
+  const int c = positioner.AddShade(&controller_c, kTravelTime, 100);
+  const int a = positioner.AddShade(&controller_a, kTravelTime, 100);
+  const int b = positioner.AddShade(&controller_b, kTravelTime, 100);
+
+  // Every wait for a deadline ends a little late. Moves that are rescheduled
+  // while a start command is about to be sent must not be planned into that
+  // transmission.
+  TEST_ASSERT_TRUE(positioner.MoveTo(c, 10));
+  TEST_ASSERT_TRUE(positioner.MoveTo(a, 50));
+  TEST_ASSERT_TRUE(positioner.MoveTo(b, 55));
+  PollUntilIdle(&positioner, c, &clock);
+  PollUntilIdle(&positioner, a, &clock);
+  PollUntilIdle(&positioner, b, &clock);
+
+  TEST_ASSERT_EQUAL(2, rc_c.num_commands());
+  TEST_ASSERT_EQUAL(2, rc_a.num_commands());
+  TEST_ASSERT_EQUAL(2, rc_b.num_commands());
+  TEST_ASSERT_UINT32_WITHIN(
+      100, 18000000, rc_c.kickoff_us(1) - rc_c.kickoff_us(0));
+  TEST_ASSERT_UINT32_WITHIN(
+      100, 10000000, rc_a.kickoff_us(1) - rc_a.kickoff_us(0));
+  TEST_ASSERT_UINT32_WITHIN(
+      100, 9000000, rc_b.kickoff_us(1) - rc_b.kickoff_us(0));
+  TEST_ASSERT_EQUAL(10, positioner.position(c));
+  TEST_ASSERT_EQUAL(50, positioner.position(a));
+  TEST_ASSERT_EQUAL(55, positioner.position(b));
+}
+
+void TestMoveTo_ShortMove() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc(&clock);
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+  rts::PositionController positioner(&clock);
+  const int shade = positioner.AddShade(&controller, kTravelTime, 50);
+
+  // 2% takes 400ms, which is shorter than the start command's transmission.
+  TEST_ASSERT_FALSE(positioner.MoveTo(shade, 48));
+  TEST_ASSERT_FALSE(positioner.busy(shade));
+  positioner.Poll();
+  TEST_ASSERT_EQUAL(0, rc.num_commands());
+  TEST_ASSERT_EQUAL(50, positioner.position(shade));
+
+  // 5% takes 1s, which is long enough to stop on time.
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 45));
+  PollUntilIdle(&positioner, shade, &clock);
+  TEST_ASSERT_EQUAL(2, rc.num_commands());
+  TEST_ASSERT_EQUAL_UINT32(1000000, rc.kickoff_us(1) - rc.kickoff_us(0));
+  TEST_ASSERT_EQUAL(45, positioner.position(shade));
+}
+
+void TestMoveTo_Reverse() {
+  VirtualClock clock;
+  VirtualTransmitter tx(&clock);
+  RecordingRollingCode rc(&clock);
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+  rts::PositionController positioner(&clock);
+  const int shade = positioner.AddShade(&controller, kTravelTime, 100);
+
+  // Move down to the end stop, and reverse halfway.
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 0));
+  const uint32_t halfway_us =
+      clock.NowMicroseconds() + rts::FirstFrameMicroseconds() + 10000000;
+  while (static_cast<int32_t>(clock.NowMicroseconds() - halfway_us) < 0) {
+    positioner.Poll();
+    clock.DelayMicroseconds(500);
+  }
+  TEST_ASSERT_EQUAL(50, positioner.position(shade));
+
+  TEST_ASSERT_TRUE(positioner.MoveTo(shade, 75));
+  PollUntilIdle(&positioner, shade, &clock);
+  TEST_ASSERT_EQUAL(3, rc.num_commands());
+  TEST_ASSERT_EQUAL(75, positioner.position(shade));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+
+  RUN_TEST(TestMoveTo_StopsOnTime);
+  RUN_TEST(TestMoveTo_EndStop);
+  RUN_TEST(TestMoveTo_InvalidArguments);
+  RUN_TEST(TestMoveTo_ConcurrentShades);
+  RUN_TEST(TestMoveTo_RetargetWithPendingStops);
+  RUN_TEST(TestMoveTo_StopDisplacesPendingStart);
+  RUN_TEST(TestMoveTo_ClockOvershoot);
+  RUN_TEST(TestMoveTo_ShortMove);
+  RUN_TEST(TestMoveTo_Reverse);
+
+  UNITY_END();
+  return 0;
+}
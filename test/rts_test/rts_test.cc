@@ -69,6 +69,9 @@ class FakeTransmitter : public rts::TransmitInterface {
     }
 
     time_ += us;
+    if (first_frame_us_ == 0 && bits_read_ == sizeof(payload_) * 8) {
+      first_frame_us_ = time_;
+    }
   }
 
   // Returns the pointer to the last captured payload. If multiple frames are
@@ -78,6 +81,13 @@ class FakeTransmitter : public rts::TransmitInterface {
   // Number of bits read for the most recent payload.
   unsigned int bits_read() const { return bits_read_; }
 
+  // Virtual time, in microseconds, spent in DelayMicroseconds().
+  uint32_t time() const { return time_; }
+
+  // Virtual time, in microseconds, at which the first complete payload was
+  // read, or 0 if none was read yet.
+  uint32_t first_frame_us() const { return first_frame_us_; }
+
  private:
   enum class State {
     kUnknown,
@@ -95,6 +105,8 @@ class FakeTransmitter : public rts::TransmitInterface {
   State state_ = State::kUnknown;
   // Virtual time in microseconds.
   uint32_t time_ = 0;
+  // Virtual time at which the first complete payload was read.
+  uint32_t first_frame_us_ = 0;
   // Whether the transmitter is enabled (high: true) or disabled (low: false).
   bool pin_ = false;
 };
@@ -185,6 +197,18 @@ void TestTransmitFrame() {
   TEST_ASSERT_EQUAL_HEX(expected_frame.address(), deserialized.address());
 }
 
+void TestTransmitFrame_Duration() {
+  FakeTransmitter tx;
+
+  rts::Frame frame(/*address=*/0xC0FFEE);
+  TransmitFrame(frame, &tx);
+
+  // 48ms of wakeup, 2 hardware syncs, a software sync, and 56 symbols.
+  TEST_ASSERT_EQUAL_UINT32(135120, rts::FirstFrameMicroseconds());
+  TEST_ASSERT_EQUAL_UINT32(rts::FirstFrameMicroseconds(), tx.first_frame_us());
+  TEST_ASSERT_EQUAL_UINT32(rts::TransmitFrameMicroseconds(), tx.time());
+}
+
 void TestController() {
   InMemoryRollingCode rc;
   rc.Write(0x1337); // Initial rolling code.
@@ -220,6 +244,81 @@ void TestController() {
   TEST_ASSERT_EQUAL(0x1339, rc.Read());
 }
 
+void TestController_Prerender() {
+  InMemoryRollingCode rc;
+  rc.Write(0x1337); // Initial rolling code.
+  FakeTransmitter tx;
+  rts::Controller controller(/*address=*/0xC0FFEE, &rc, &tx);
+
+  // Nothing is prerendered until Prerender() is called.
+  TEST_ASSERT_NULL(controller.prerendered_payload(rts::ControlCode::kDown));
+  controller.Prerender();
+  const uint8_t* const prerendered =
+      controller.prerendered_payload(rts::ControlCode::kDown);
+  TEST_ASSERT_NOT_NULL(prerendered);
+  uint8_t expected_payload[rts::Frame::kPayloadLength];
+  memcpy(expected_payload, prerendered, sizeof(expected_payload));
+  uint8_t stale_payload[rts::Frame::kPayloadLength];
+  memcpy(stale_payload,
+         controller.prerendered_payload(rts::ControlCode::kMy),
+         sizeof(stale_payload));
+
+  // Codes other than kUp, kDown and kMy are never prerendered.
+  TEST_ASSERT_NULL(controller.prerendered_payload(rts::ControlCode::kProgram));
+
+  // Send the prerendered command. The prerendered payload is sent as is.
+  controller.SendControlCode(rts::ControlCode::kDown);
+  TEST_ASSERT_EQUAL(rts::Frame::kPayloadLength * 8, tx.bits_read());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(
+      expected_payload, tx.payload(), sizeof(expected_payload));
+
+  rts::Frame actual_frame;
+  TEST_ASSERT_TRUE(DeserializeFrame(tx.payload(), &actual_frame));
+  TEST_ASSERT_EQUAL(rts::ControlCode::kDown, actual_frame.control_code());
+  TEST_ASSERT_EQUAL(0x1337, actual_frame.rolling_code());
+  TEST_ASSERT_EQUAL(0xC0FFEE, actual_frame.address());
+  TEST_ASSERT_EQUAL(0x1338, rc.Read());
+
+  // The prerendered payloads are stale after the rolling code advances, so
+  // the next command is serialized on demand with the new rolling code.
+  TEST_ASSERT_NULL(controller.prerendered_payload(rts::ControlCode::kMy));
+  TEST_ASSERT_NULL(controller.prerendered_payload(rts::ControlCode::kUp));
+  TEST_ASSERT_NULL(controller.prerendered_payload(rts::ControlCode::kDown));
+  const int first_frame_counter = actual_frame.counter();
+  controller.SendControlCode(rts::ControlCode::kMy);
+  TEST_ASSERT_TRUE(DeserializeFrame(tx.payload(), &actual_frame));
+  TEST_ASSERT_EQUAL(first_frame_counter + 1, actual_frame.counter());
+  TEST_ASSERT_EQUAL(rts::ControlCode::kMy, actual_frame.control_code());
+  TEST_ASSERT_EQUAL(0x1338, actual_frame.rolling_code());
+  // The kMy payload prerendered for the old rolling code was not sent.
+  TEST_ASSERT_NOT_EQUAL(
+      0, memcmp(stale_payload, tx.payload(), sizeof(stale_payload)));
+
+  // Prerendering again picks up the new rolling code.
+  controller.Prerender();
+  rts::Frame prerendered_frame;
+  TEST_ASSERT_TRUE(DeserializeFrame(
+      controller.prerendered_payload(rts::ControlCode::kUp),
+      &prerendered_frame));
+  TEST_ASSERT_EQUAL(rts::ControlCode::kUp, prerendered_frame.control_code());
+  TEST_ASSERT_EQUAL(0x1339, prerendered_frame.rolling_code());
+  TEST_ASSERT_EQUAL(first_frame_counter + 2, prerendered_frame.counter());
+
+  controller.SendControlCode(rts::ControlCode::kUp);
+  TEST_ASSERT_TRUE(DeserializeFrame(tx.payload(), &actual_frame));
+  TEST_ASSERT_EQUAL(first_frame_counter + 2, actual_frame.counter());
+  TEST_ASSERT_EQUAL(rts::ControlCode::kUp, actual_frame.control_code());
+  TEST_ASSERT_EQUAL(0x1339, actual_frame.rolling_code());
+  TEST_ASSERT_EQUAL(0x133A, rc.Read());
+
+  // Control codes that are not prerendered are serialized on demand.
+  controller.Prerender();
+  controller.SendControlCode(rts::ControlCode::kProgram);
+  TEST_ASSERT_TRUE(DeserializeFrame(tx.payload(), &actual_frame));
+  TEST_ASSERT_EQUAL(rts::ControlCode::kProgram, actual_frame.control_code());
+  TEST_ASSERT_EQUAL(0x133A, actual_frame.rolling_code());
+}
+
 int main(int argc, char** argv) {
   UNITY_BEGIN();
 
@@ -228,7 +327,9 @@ int main(int argc, char** argv) {
   RUN_TEST(TestDeserializeFrame_BadChecksum);
   RUN_TEST(TestSerializeDeserialize);
   RUN_TEST(TestTransmitFrame);
+  RUN_TEST(TestTransmitFrame_Duration);
   RUN_TEST(TestController);
+  RUN_TEST(TestController_Prerender);
 
   UNITY_END();
   return 0;